@@ -0,0 +1,125 @@
+#include "analysis.h"
+#include <string.h>
+
+// Encoded size in bytes of the instruction starting with `opcode`, or 0 if
+// the emulator does not implement it. Must match what execute() consumes.
+uint8_t instruction_length(uint8_t opcode, uint8_t next)
+{
+    switch (opcode)
+    {
+    case 0xB0: case 0xB1: case 0xB2: case 0xB3:
+    case 0xB4: case 0xB5: case 0xB6: case 0xB7:
+    case 0x88: case 0x00: case 0x2C: case 0x28:
+    case 0xFE: case 0xF6: case 0x20: case 0x08:
+    case 0xD0: case 0xD2: case 0x38: case 0x3C:
+    case 0xEB: case 0x74: case 0x75: case 0x7F: case 0x7E:
+        return 2;
+
+    case 0xE8: case 0xB9: case 0xBE: case 0xBF:
+        return 3;
+
+    case 0xC3: case 0x50: case 0x52: case 0x58: case 0x5A:
+    case 0xFC: case 0xFD: case 0xF4:
+    case 0xA4: case 0xA6: case 0xAA: case 0xAC:
+        return 1;
+
+    case 0x0F:
+        return (next == 0x31 || next == 0x33) ? 2 : 0;
+
+    case PREFIX_REPNE:
+    case PREFIX_REP:
+        return (next == 0xA4 || next == 0xA6 || next == 0xAA || next == 0xAC) ? 2 : 0;
+
+    default:
+        return 0;
+    }
+}
+
+static void add_leader(ProgramAnalysis *analysis, uint8_t *worklist, int *top,
+                       bool *queued, uint8_t addr)
+{
+    analysis->flags[addr] |= INSN_LEADER;
+    if (!queued[addr])
+    {
+        queued[addr] = true;
+        worklist[(*top)++] = addr;
+    }
+}
+
+// Recursive descent from `entry`, following fallthrough and direct branch
+// targets. Unknown opcodes simply end the walk; they fault at run time.
+void analyze_program(ProgramAnalysis *analysis, const uint8_t *memory, uint8_t entry)
+{
+    uint8_t worklist[MEMORY_SIZE];
+    bool queued[MEMORY_SIZE] = {false};
+    int top = 0;
+
+    memset(analysis, 0, sizeof(ProgramAnalysis));
+    add_leader(analysis, worklist, &top, queued, entry);
+
+    while (top > 0)
+    {
+        uint8_t addr = worklist[--top];
+        bool block_open = true;
+
+        while (block_open && !(analysis->flags[addr] & INSN_VALID))
+        {
+            uint8_t opcode = memory[addr];
+            uint8_t length = instruction_length(opcode, memory[(uint8_t)(addr + 1)]);
+            if (length == 0)
+            {
+                break;
+            }
+
+            uint8_t next = addr + length;
+            analysis->length[addr] = length;
+            analysis->flags[addr] |= INSN_VALID;
+            analysis->num_insns++;
+
+            switch (opcode)
+            {
+            case 0xEB: // JMP rel8
+            case 0x74: // JE rel8
+            case 0x75: // JNE rel8
+            case 0x7F: // JG rel8
+            case 0x7E: // JLE rel8
+                analysis->target[addr] = next + (int8_t)memory[(uint8_t)(addr + 1)];
+                analysis->flags[addr] |= INSN_BRANCH | INSN_DIRECT;
+                add_leader(analysis, worklist, &top, queued, analysis->target[addr]);
+                if (opcode != 0xEB)
+                {
+                    add_leader(analysis, worklist, &top, queued, next);
+                }
+                block_open = false;
+                break;
+
+            case 0xE8: // CALL rel16, returns to the next instruction
+                analysis->target[addr] = next + (memory[(uint8_t)(addr + 1)] |
+                                                 memory[(uint8_t)(addr + 2)] << 8);
+                analysis->flags[addr] |= INSN_BRANCH | INSN_DIRECT;
+                add_leader(analysis, worklist, &top, queued, analysis->target[addr]);
+                add_leader(analysis, worklist, &top, queued, next);
+                block_open = false;
+                break;
+
+            case 0xC3: // RET
+            case 0xF4: // HLT
+                analysis->flags[addr] |= INSN_BRANCH;
+                block_open = false;
+                break;
+
+            default:
+                addr = next;
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < MEMORY_SIZE; i++)
+    {
+        if ((analysis->flags[i] & (INSN_VALID | INSN_LEADER)) == (INSN_VALID | INSN_LEADER))
+        {
+            analysis->num_blocks++;
+        }
+    }
+}
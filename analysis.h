@@ -0,0 +1,26 @@
+#ifndef CPU_ANALYSIS_H
+#define CPU_ANALYSIS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tiny_x86.h"
+
+#define INSN_VALID 0x01  // Reachable instruction starts here
+#define INSN_LEADER 0x02 // First instruction of a basic block
+#define INSN_BRANCH 0x04 // Last instruction of a basic block
+#define INSN_DIRECT 0x08 // Branch with a static target
+
+// Static decode of a loaded image, indexed by address
+typedef struct
+{
+    uint8_t length[MEMORY_SIZE];
+    uint8_t flags[MEMORY_SIZE];
+    uint8_t target[MEMORY_SIZE];
+    uint16_t num_insns;
+    uint16_t num_blocks;
+} ProgramAnalysis;
+
+uint8_t instruction_length(uint8_t opcode, uint8_t next);
+void analyze_program(ProgramAnalysis *analysis, const uint8_t *memory, uint8_t entry);
+
+#endif
@@ -0,0 +1,301 @@
+#include "bundle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Check the header and every entry up front so loading a guest later needs
+// no validation beyond the index
+static int check_bundle(Bundle *bundle)
+{
+    BundleHeader header;
+    if (bundle->size < sizeof(header))
+    {
+        return -1;
+    }
+    memcpy(&header, bundle->data, sizeof(header));
+
+    if (header.magic != BUNDLE_MAGIC || header.version != BUNDLE_VERSION ||
+        header.count > (bundle->size - sizeof(header)) / sizeof(BundleEntry))
+    {
+        return -1;
+    }
+
+    bundle->count = header.count;
+    bundle->entries = (const BundleEntry *)(bundle->data + sizeof(header));
+    for (uint32_t i = 0; i < bundle->count; i++)
+    {
+        const BundleEntry *entry = &bundle->entries[i];
+        if (entry->size > MEMORY_SIZE || entry->offset > bundle->size ||
+            entry->size > bundle->size - entry->offset)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Maps the whole file once; guests are then set up from the mapping with no
+// further file I/O
+int open_bundle(Bundle *bundle, const char *path)
+{
+    memset(bundle, 0, sizeof(Bundle));
+
+#ifdef _WIN32
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror("Failed to open bundle");
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = size > 0 ? malloc(size) : NULL;
+    if (!data || fread(data, 1, size, f) != (size_t)size)
+    {
+        free(data);
+        fclose(f);
+        printf("Failed to read bundle\n");
+        return -1;
+    }
+    fclose(f);
+    bundle->data = data;
+    bundle->size = size;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Failed to open bundle");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        printf("Failed to read bundle\n");
+        return -1;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror("Failed to map bundle");
+        return -1;
+    }
+    bundle->data = data;
+    bundle->size = st.st_size;
+#endif
+
+    if (check_bundle(bundle) != 0)
+    {
+        printf("Invalid bundle file\n");
+        close_bundle(bundle);
+        return -1;
+    }
+    return 0;
+}
+
+void close_bundle(Bundle *bundle)
+{
+    if (bundle->data)
+    {
+#ifdef _WIN32
+        free((void *)bundle->data);
+#else
+        munmap((void *)bundle->data, bundle->size);
+#endif
+    }
+    memset(bundle, 0, sizeof(Bundle));
+}
+
+// Guest memory is only MEMORY_SIZE bytes, so copying the image out of the
+// mapping is cheaper than any copy-on-write scheme
+int load_bundle_program(const Bundle *bundle, uint32_t index, CPU *cpu)
+{
+    if (index >= bundle->count)
+    {
+        return -1;
+    }
+
+    const BundleEntry *entry = &bundle->entries[index];
+    init_cpu(cpu);
+    memcpy(cpu->memory, bundle->data + entry->offset, entry->size);
+    memcpy(cpu->regs, entry->regs, sizeof(cpu->regs));
+    cpu->si = entry->si;
+    cpu->di = entry->di;
+    cpu->ip = entry->ip;
+    cpu->sp = entry->sp;
+    cpu->flags = entry->flags;
+    return 0;
+}
+
+// Writes each guest's first `sizes[i]` bytes of memory and its registers
+int save_bundle(const char *path, const CPU *guests, const uint16_t *sizes, uint32_t count)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror("Failed to create bundle");
+        return -1;
+    }
+
+    BundleHeader header = {.magic = BUNDLE_MAGIC, .version = BUNDLE_VERSION, .count = count};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    uint32_t offset = sizeof(header) + count * sizeof(BundleEntry);
+    for (uint32_t i = 0; i < count && ok; i++)
+    {
+        const CPU *guest = &guests[i];
+        BundleEntry entry = {
+            .offset = offset,
+            .size = sizes[i] < MEMORY_SIZE ? sizes[i] : MEMORY_SIZE,
+            .si = guest->si,
+            .di = guest->di,
+            .ip = guest->ip,
+            .sp = guest->sp,
+            .flags = guest->flags,
+        };
+        memcpy(entry.regs, guest->regs, sizeof(entry.regs));
+        ok = fwrite(&entry, sizeof(entry), 1, f) == 1;
+        offset += entry.size;
+    }
+
+    for (uint32_t i = 0; i < count && ok; i++)
+    {
+        size_t size = sizes[i] < MEMORY_SIZE ? sizes[i] : MEMORY_SIZE;
+        ok = fwrite(guests[i].memory, 1, size, f) == size;
+    }
+
+    if (fclose(f) != 0 || !ok)
+    {
+        printf("Failed to write bundle\n");
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct
+{
+    const Bundle *bundle;
+    uint64_t max_steps;
+    BundleGuestDone done;
+    void *context;
+    atomic_uint next;     // Next guest a worker will claim
+    uint32_t next_report; // Next guest to hand to `done`
+    CPU **finished;       // Guests that finished ahead of next_report
+    pthread_mutex_t lock;
+    pthread_cond_t reported;
+} BundleRun;
+
+// Reports `index` and then any buffered guests that were waiting on it.
+// Called with the lock held.
+static void report_in_order(BundleRun *run, uint32_t index, const CPU *cpu)
+{
+    run->done(index, cpu, run->context);
+    run->next_report++;
+    while (run->next_report < run->bundle->count && run->finished[run->next_report])
+    {
+        CPU *buffered = run->finished[run->next_report];
+        run->finished[run->next_report] = NULL;
+        run->done(run->next_report, buffered, run->context);
+        free(buffered);
+        run->next_report++;
+    }
+    pthread_cond_broadcast(&run->reported);
+}
+
+// Claims guests one at a time until the bundle is exhausted. Each worker
+// reuses a single CPU, so a guest costs one image copy and no syscalls.
+static void *bundle_worker(void *arg)
+{
+    BundleRun *run = arg;
+    CPU cpu;
+
+    for (;;)
+    {
+        uint32_t index = atomic_fetch_add(&run->next, 1);
+        if (index >= run->bundle->count)
+        {
+            break;
+        }
+
+        load_bundle_program(run->bundle, index, &cpu);
+        for (uint64_t steps = 0; !cpu.halted && steps < run->max_steps; steps++)
+        {
+            execute(&cpu, false);
+        }
+
+        // A guest that finishes early is parked for whoever reports the one
+        // before it, so workers never wait on a slow guest. Only if there is
+        // no memory to park it does this worker wait its turn; guests are
+        // claimed in order, so the one being waited for is still running.
+        pthread_mutex_lock(&run->lock);
+        if (index != run->next_report)
+        {
+            CPU *buffered = malloc(sizeof(CPU));
+            if (buffered)
+            {
+                *buffered = cpu;
+                run->finished[index] = buffered;
+                pthread_mutex_unlock(&run->lock);
+                continue;
+            }
+            while (index != run->next_report)
+            {
+                pthread_cond_wait(&run->reported, &run->lock);
+            }
+        }
+        report_in_order(run, index, &cpu);
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+// Runs every guest on `workers` threads sharing the one mapping, stopping
+// any guest that has not halted after `max_steps` instructions. The calling
+// thread is one of the workers; if a thread cannot be started the remaining
+// ones simply take its share.
+int run_bundle(const Bundle *bundle, unsigned workers, uint64_t max_steps,
+               BundleGuestDone done, void *context)
+{
+    BundleRun run = {.bundle = bundle, .max_steps = max_steps, .done = done, .context = context};
+    run.finished = calloc(bundle->count ? bundle->count : 1, sizeof(CPU *));
+    if (!run.finished)
+    {
+        return -1;
+    }
+    atomic_init(&run.next, 0);
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.reported, NULL);
+
+    pthread_t threads[MAX_BUNDLE_WORKERS];
+    unsigned started = 0;
+    while (started + 1 < workers && started + 1 < MAX_BUNDLE_WORKERS &&
+           pthread_create(&threads[started], NULL, bundle_worker, &run) == 0)
+    {
+        started++;
+    }
+    bundle_worker(&run);
+
+    for (unsigned i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&run.reported);
+    pthread_mutex_destroy(&run.lock);
+    free(run.finished);
+    return 0;
+}
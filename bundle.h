@@ -0,0 +1,57 @@
+#ifndef CPU_BUNDLE_H
+#define CPU_BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tiny_x86.h"
+
+#define BUNDLE_MAGIC 0x4E425854 // "TXBN"
+#define BUNDLE_VERSION 1
+#define MAX_BUNDLE_WORKERS 64
+#define BUNDLE_DEFAULT_STEPS 1000000
+
+// On-disk layout: BundleHeader, then `count` BundleEntry records, then the
+// raw images at the offsets the entries give
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+} BundleHeader;
+
+typedef struct
+{
+    uint32_t offset; // From the start of the file
+    uint32_t size;   // Image bytes, at most MEMORY_SIZE
+    uint8_t regs[8]; // Same order as CPU.regs
+    uint8_t si;
+    uint8_t di;
+    uint8_t ip;
+    uint8_t sp;
+    uint16_t flags;
+    uint16_t reserved;
+} BundleEntry;
+
+// Read-only view of a mapped bundle. Safe to share between threads once
+// open_bundle() has returned.
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    uint32_t count;
+    const BundleEntry *entries;
+} Bundle;
+
+// Called once per guest after it halts or runs out of steps (`cpu->halted`
+// is then false), in guest order and never from two threads at once
+typedef void (*BundleGuestDone)(uint32_t index, const CPU *cpu, void *context);
+
+int open_bundle(Bundle *bundle, const char *path);
+void close_bundle(Bundle *bundle);
+int load_bundle_program(const Bundle *bundle, uint32_t index, CPU *cpu);
+int save_bundle(const char *path, const CPU *guests, const uint16_t *sizes, uint32_t count);
+int run_bundle(const Bundle *bundle, unsigned workers, uint64_t max_steps,
+               BundleGuestDone done, void *context);
+
+#endif
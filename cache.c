@@ -1,6 +1,7 @@
 #include "cache.h"
 #include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 static inline uint8_t get_cache_index(uint16_t address)
 {
@@ -61,12 +62,12 @@ uint8_t cache_fetch_byte(InstructionCache *cache, const uint8_t *memory,
 
 void print_cache_stats(const InstructionCache *cache)
 {
-    uint32_t total_accesses = cache->hits + cache->misses;
+    uint64_t total_accesses = cache->hits + cache->misses;
     float hit_rate = total_accesses > 0 ? (float)cache->hits / total_accesses * 100.0 : 0.0;
 
     printf("\nCache Statistics:\n");
-    printf("Total accesses: %u\n", total_accesses);
-    printf("Cache hits: %u\n", cache->hits);
-    printf("Cache misses: %u\n", cache->misses);
+    printf("Total accesses: %" PRIu64 "\n", total_accesses);
+    printf("Cache hits: %" PRIu64 "\n", cache->hits);
+    printf("Cache misses: %" PRIu64 "\n", cache->misses);
     printf("Hit rate: %.2f%%\n", hit_rate);
 }
\ No newline at end of file
@@ -19,8 +19,8 @@ typedef struct
 typedef struct
 {
     CacheLine lines[NUM_CACHE_LINES];
-    uint32_t hits;
-    uint32_t misses;
+    uint64_t hits;
+    uint64_t misses;
 } InstructionCache;
 
 void init_cache(InstructionCache *cache);
@@ -0,0 +1,85 @@
+#include "counters.h"
+#include "tiny_x86.h"
+#include <inttypes.h>
+
+static const char *const counter_names[NUM_COUNTERS] = {
+    "instructions_retired",
+    "icache_hits",
+    "icache_misses",
+    "branches_taken",
+    "calls",
+    "returns",
+    "stack_high_water",
+};
+
+const char *counter_name(CounterId id)
+{
+    return id < NUM_COUNTERS ? counter_names[id] : NULL;
+}
+
+// Unknown ids read as 0, which is also what RDPMC hands the guest
+uint64_t read_counter(const CPU *cpu, CounterId id)
+{
+    switch (id)
+    {
+    case CTR_ICACHE_HITS:
+        return cpu->icache.hits;
+    case CTR_ICACHE_MISSES:
+        return cpu->icache.misses;
+    default:
+        return id < NUM_COUNTERS ? cpu->counters.values[id] : 0;
+    }
+}
+
+void export_counters_json(const CPU *cpu, FILE *out)
+{
+    fprintf(out, "{");
+    for (int id = 0; id < NUM_COUNTERS; id++)
+    {
+        fprintf(out, "\"%s\": %" PRIu64 ", ", counter_names[id], read_counter(cpu, id));
+    }
+
+    // Only opcodes that actually ran
+    fprintf(out, "\"opcodes\": {");
+    const char *sep = "";
+    for (int op = 0; op < 256; op++)
+    {
+        if (cpu->counters.opcodes[op])
+        {
+            fprintf(out, "%s\"0x%02X\": %" PRIu64, sep, op, cpu->counters.opcodes[op]);
+            sep = ", ";
+        }
+    }
+    for (int op = 0; op < 256; op++)
+    {
+        if (cpu->counters.opcodes_0f[op])
+        {
+            fprintf(out, "%s\"0x0F%02X\": %" PRIu64, sep, op, cpu->counters.opcodes_0f[op]);
+            sep = ", ";
+        }
+    }
+    fprintf(out, "}}\n");
+}
+
+void export_counters_csv(const CPU *cpu, FILE *out)
+{
+    fprintf(out, "counter,value\n");
+    for (int id = 0; id < NUM_COUNTERS; id++)
+    {
+        fprintf(out, "%s,%" PRIu64 "\n", counter_names[id], read_counter(cpu, id));
+    }
+    for (int op = 0; op < 256; op++)
+    {
+        if (cpu->counters.opcodes[op])
+        {
+            fprintf(out, "opcode_0x%02X,%" PRIu64 "\n", op, cpu->counters.opcodes[op]);
+        }
+    }
+    for (int op = 0; op < 256; op++)
+    {
+        if (cpu->counters.opcodes_0f[op])
+        {
+            fprintf(out, "opcode_0x0F%02X,%" PRIu64 "\n", op, cpu->counters.opcodes_0f[op]);
+        }
+    }
+}
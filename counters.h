@@ -0,0 +1,34 @@
+#ifndef CPU_COUNTERS_H
+#define CPU_COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum
+{
+    CTR_INSTRUCTIONS,
+    CTR_ICACHE_HITS,
+    CTR_ICACHE_MISSES,
+    CTR_BRANCHES_TAKEN,
+    CTR_CALLS,
+    CTR_RETURNS,
+    CTR_STACK_HIGH_WATER,
+    NUM_COUNTERS
+} CounterId;
+
+// Events counted directly by execute(). Icache hits/misses live in the
+// InstructionCache and are read from there.
+typedef struct
+{
+    uint64_t values[NUM_COUNTERS];
+    uint64_t opcodes[256];    // By opcode, or by string opcode after REP/REPNE
+    uint64_t opcodes_0f[256]; // Second byte of 0F xx opcodes
+} PerfCounters;
+
+struct CPU;
+const char *counter_name(CounterId id);
+uint64_t read_counter(const struct CPU *cpu, CounterId id);
+void export_counters_json(const struct CPU *cpu, FILE *out);
+void export_counters_csv(const struct CPU *cpu, FILE *out);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef CPU_COVERAGE_H
+#define CPU_COVERAGE_H
+
+#include <stdint.h>
+
+// One slot per (branch address, destination) pair. IP is 8 bits, so every
+// edge gets its own slot and nothing collides.
+#define COVERAGE_MAP_SIZE 65536
+
+// Saturating hit counts for edges taken by branch instructions, plus the
+// list of slots touched since the last reset so clearing costs only what
+// was used
+typedef struct CoverageMap
+{
+    uint8_t hits[COVERAGE_MAP_SIZE];
+    uint16_t touched[COVERAGE_MAP_SIZE];
+    uint32_t num_touched;
+} CoverageMap;
+
+static inline void coverage_record(CoverageMap *map, uint8_t from, uint8_t to)
+{
+    uint16_t edge = from << 8 | to;
+    if (map->hits[edge] == 0)
+    {
+        map->touched[map->num_touched++] = edge;
+    }
+    if (map->hits[edge] != 0xFF)
+    {
+        map->hits[edge]++;
+    }
+}
+
+static inline void coverage_reset(CoverageMap *map)
+{
+    for (uint32_t i = 0; i < map->num_touched; i++)
+    {
+        map->hits[map->touched[i]] = 0;
+    }
+    map->num_touched = 0;
+}
+
+#endif
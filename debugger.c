@@ -0,0 +1,285 @@
+#include "debugger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+int init_debugger(Debugger *dbg, CPU *cpu, uint64_t interval, size_t budget)
+{
+    memset(dbg, 0, sizeof(Debugger));
+    dbg->cpu = cpu;
+    dbg->interval = interval > 0 ? interval : DEFAULT_CHECKPOINT_INTERVAL;
+    dbg->capacity = budget / sizeof(Checkpoint);
+
+    // Need room for the initial state plus at least one more
+    if (dbg->capacity < 2)
+    {
+        return -1;
+    }
+
+    dbg->checkpoints = malloc(dbg->capacity * sizeof(Checkpoint));
+    if (!dbg->checkpoints)
+    {
+        return -1;
+    }
+
+    dbg->checkpoints[0].icount = 0;
+    dbg->checkpoints[0].state = *cpu;
+    dbg->count = 1;
+    return 0;
+}
+
+void free_debugger(Debugger *dbg)
+{
+    free(dbg->checkpoints);
+    dbg->checkpoints = NULL;
+    dbg->count = 0;
+    dbg->capacity = 0;
+}
+
+// Checkpoints always hold every multiple of `interval` up to the newest one,
+// so checkpoint i was taken at instruction i * interval. When the budget is
+// exhausted, drop every other checkpoint and double the interval: memory
+// stays bounded and that invariant still holds.
+static void thin_checkpoints(Debugger *dbg)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < dbg->count; i += 2)
+    {
+        dbg->checkpoints[kept++] = dbg->checkpoints[i];
+    }
+    dbg->count = kept;
+    dbg->interval *= 2;
+}
+
+static void record_checkpoint(Debugger *dbg)
+{
+    if (dbg->icount % dbg->interval != 0 ||
+        dbg->checkpoints[dbg->count - 1].icount >= dbg->icount)
+    {
+        return;
+    }
+
+    if (dbg->count == dbg->capacity)
+    {
+        thin_checkpoints(dbg);
+        if (dbg->icount % dbg->interval != 0)
+        {
+            return;
+        }
+    }
+
+    Checkpoint *cp = &dbg->checkpoints[dbg->count++];
+    cp->icount = dbg->icount;
+    cp->state = *dbg->cpu;
+}
+
+static void restore_checkpoint(Debugger *dbg, size_t index)
+{
+    *dbg->cpu = dbg->checkpoints[index].state;
+    dbg->icount = dbg->checkpoints[index].icount;
+}
+
+static size_t nearest_checkpoint(const Debugger *dbg, uint64_t target)
+{
+    uint64_t index = target / dbg->interval;
+    return index < dbg->count ? index : dbg->count - 1;
+}
+
+bool debugger_step(Debugger *dbg, bool verbose)
+{
+    if (dbg->cpu->halted)
+    {
+        return false;
+    }
+
+    execute(dbg->cpu, verbose);
+    dbg->icount++;
+    record_checkpoint(dbg);
+    return true;
+}
+
+// Run until IP reaches `breakpoint` (when `use_breakpoint` is set) or the
+// program halts. Returns the number of instructions executed.
+uint64_t debugger_continue(Debugger *dbg, bool use_breakpoint, uint8_t breakpoint, bool verbose)
+{
+    uint64_t start = dbg->icount;
+    while (debugger_step(dbg, verbose) && !(use_breakpoint && dbg->cpu->ip == breakpoint))
+    {
+    }
+    return dbg->icount - start;
+}
+
+// Move to the state right before instruction `target` executes. Replays at
+// most one checkpoint interval from the nearest checkpoint, unless the
+// target lies beyond anything recorded so far. Returns false if the program
+// halts before reaching `target`.
+bool debugger_seek(Debugger *dbg, uint64_t target)
+{
+    size_t index = nearest_checkpoint(dbg, target);
+    if (target < dbg->icount || dbg->checkpoints[index].icount > dbg->icount)
+    {
+        restore_checkpoint(dbg, index);
+    }
+
+    while (dbg->icount < target && debugger_step(dbg, false))
+    {
+    }
+    return dbg->icount == target;
+}
+
+bool debugger_reverse_step(Debugger *dbg)
+{
+    if (dbg->icount == 0)
+    {
+        return false;
+    }
+    return debugger_seek(dbg, dbg->icount - 1);
+}
+
+// Go back to the most recent point where IP was `breakpoint`. Each checkpoint
+// segment is replayed once, newest first, so the cost is proportional to how
+// far back the hit is. Stays put and returns false if there is no such point.
+bool debugger_reverse_continue(Debugger *dbg, uint8_t breakpoint)
+{
+    uint64_t origin = dbg->icount;
+    if (origin == 0)
+    {
+        return false;
+    }
+
+    uint64_t end = origin;
+    size_t index = nearest_checkpoint(dbg, origin - 1);
+    while (1)
+    {
+        bool found = false;
+        uint64_t hit = 0;
+
+        restore_checkpoint(dbg, index);
+        while (dbg->icount < end)
+        {
+            if (dbg->cpu->ip == breakpoint)
+            {
+                found = true;
+                hit = dbg->icount;
+            }
+            if (!debugger_step(dbg, false))
+            {
+                break;
+            }
+        }
+
+        if (found)
+        {
+            return debugger_seek(dbg, hit);
+        }
+        if (index == 0)
+        {
+            break;
+        }
+        end = dbg->checkpoints[index].icount;
+        index--;
+    }
+
+    debugger_seek(dbg, origin);
+    return false;
+}
+
+static void print_position(const Debugger *dbg, FILE *out)
+{
+    const CPU *cpu = dbg->cpu;
+    fprintf(out, "[%" PRIu64 "] IP 0x%02X  AL 0x%02X BL 0x%02X CL 0x%02X DL 0x%02X  SP 0x%02X  Flags 0x%02X%s\n",
+            dbg->icount, cpu->ip, cpu->al, cpu->bl, cpu->cl, cpu->dl, cpu->sp, cpu->flags,
+            cpu->halted ? "  (halted)" : "");
+}
+
+// Optional non-negative command argument in any base strtoull accepts.
+// Returns 0 if there is none, 1 if `value` was set and -1 if it is malformed.
+static int parse_argument(const char *text, unsigned long long *value)
+{
+    char *end;
+    text += strspn(text, " \t");
+    if (*text == '\0' || *text == '\n')
+    {
+        return 0;
+    }
+    if (*text < '0' || *text > '9')
+    {
+        return -1;
+    }
+    *value = strtoull(text, &end, 0);
+    end += strspn(end, " \t\n");
+    return *end == '\0' ? 1 : -1;
+}
+
+// Line-oriented console over the recorded run. Commands:
+//   s            step one instruction
+//   c [ip]       continue to breakpoint `ip` or until halt
+//   rs           reverse step
+//   rc <ip>      reverse continue to breakpoint `ip`
+//   seek <n>     go to the state before instruction `n`
+//   p            print position and registers
+//   q            quit
+void run_debugger_console(Debugger *dbg, FILE *in, FILE *out)
+{
+    char line[128];
+    print_position(dbg, out);
+
+    while (1)
+    {
+        fprintf(out, "(tdb) ");
+        fflush(out);
+        if (!fgets(line, sizeof(line), in))
+        {
+            break;
+        }
+
+        char command[16];
+        int length;
+        if (sscanf(line, "%15s%n", command, &length) != 1)
+        {
+            continue;
+        }
+        unsigned long long arg = 0;
+        int fields = 1 + parse_argument(line + length, &arg);
+
+        if (fields == 0)
+        {
+            fprintf(out, "Arguments are non-negative numbers\n");
+            continue;
+        }
+        else if (strcmp(command, "s") == 0)
+        {
+            if (!debugger_step(dbg, true))
+                fprintf(out, "Program has halted\n");
+        }
+        else if (strcmp(command, "c") == 0)
+        {
+            debugger_continue(dbg, fields == 2, (uint8_t)arg, false);
+        }
+        else if (strcmp(command, "rs") == 0)
+        {
+            if (!debugger_reverse_step(dbg))
+                fprintf(out, "Already at the start of the recording\n");
+        }
+        else if (strcmp(command, "rc") == 0 && fields == 2)
+        {
+            if (!debugger_reverse_continue(dbg, (uint8_t)arg))
+                fprintf(out, "IP 0x%02X not reached earlier\n", (uint8_t)arg);
+        }
+        else if (strcmp(command, "seek") == 0 && fields == 2)
+        {
+            if (!debugger_seek(dbg, arg))
+                fprintf(out, "Program halts before instruction %llu\n", arg);
+        }
+        else if (strcmp(command, "q") == 0)
+        {
+            break;
+        }
+        else if (strcmp(command, "p") != 0)
+        {
+            fprintf(out, "Commands: s, c [ip], rs, rc <ip>, seek <n>, p, q\n");
+            continue;
+        }
+        print_position(dbg, out);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef CPU_DEBUGGER_H
+#define CPU_DEBUGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "tiny_x86.h"
+
+#define DEFAULT_CHECKPOINT_INTERVAL 1024
+#define DEFAULT_CHECKPOINT_BUDGET (256 * 1024)
+
+// Full CPU snapshot (registers, memory, icache) taken after `icount`
+// instructions have retired. Guest memory is only MEMORY_SIZE bytes, so a
+// straight copy is cheaper than tracking a delta.
+typedef struct
+{
+    uint64_t icount;
+    CPU state;
+} Checkpoint;
+
+typedef struct
+{
+    CPU *cpu;
+    uint64_t icount;   // Instructions retired since recording started
+    uint64_t interval; // Instructions between checkpoints
+    Checkpoint *checkpoints;
+    size_t count;
+    size_t capacity;
+} Debugger;
+
+int init_debugger(Debugger *dbg, CPU *cpu, uint64_t interval, size_t budget);
+void free_debugger(Debugger *dbg);
+
+bool debugger_step(Debugger *dbg, bool verbose);
+uint64_t debugger_continue(Debugger *dbg, bool use_breakpoint, uint8_t breakpoint, bool verbose);
+bool debugger_seek(Debugger *dbg, uint64_t target);
+bool debugger_reverse_step(Debugger *dbg);
+bool debugger_reverse_continue(Debugger *dbg, uint8_t breakpoint);
+void run_debugger_console(Debugger *dbg, FILE *in, FILE *out);
+
+#endif
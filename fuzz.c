@@ -0,0 +1,240 @@
+#include "fuzz.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t interesting_values[] = {0x00, 0x01, 0x02, 0x10, 0x20, 0x40,
+                                             0x7F, 0x80, 0x81, 0xFE, 0xFF};
+
+// xorshift64*
+static uint64_t next_random(Fuzzer *fuzzer)
+{
+    fuzzer->rng ^= fuzzer->rng >> 12;
+    fuzzer->rng ^= fuzzer->rng << 25;
+    fuzzer->rng ^= fuzzer->rng >> 27;
+    return fuzzer->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t random_below(Fuzzer *fuzzer, uint32_t limit)
+{
+    return next_random(fuzzer) % limit;
+}
+
+// AFL-style hit count buckets, so a loop running a few more times than
+// before still counts as new behaviour
+static uint8_t count_bucket(uint8_t hits)
+{
+    if (hits >= 128)
+        return 0x80;
+    if (hits >= 32)
+        return 0x40;
+    if (hits >= 16)
+        return 0x20;
+    if (hits >= 8)
+        return 0x10;
+    if (hits >= 4)
+        return 0x08;
+    if (hits == 3)
+        return 0x04;
+    return hits;
+}
+
+int init_fuzzer(Fuzzer *fuzzer, const CPU *base, uint8_t window_offset,
+                uint16_t window_size, uint64_t seed)
+{
+    memset(fuzzer, 0, sizeof(Fuzzer));
+    fuzzer->base = *base;
+    fuzzer->base.coverage = NULL;
+    fuzzer->window_offset = window_offset;
+    fuzzer->window_size = window_size < MEMORY_SIZE - window_offset ? window_size : MEMORY_SIZE - window_offset;
+    fuzzer->max_steps = FUZZ_DEFAULT_STEPS;
+    fuzzer->rng = seed ? seed : 1;
+
+    fuzzer->map = calloc(1, sizeof(CoverageMap));
+    fuzzer->virgin = calloc(COVERAGE_MAP_SIZE, 1);
+    fuzzer->corpus = malloc(FUZZ_MAX_CORPUS * sizeof(FuzzInput));
+    if (!fuzzer->map || !fuzzer->virgin || !fuzzer->corpus)
+    {
+        free_fuzzer(fuzzer);
+        return -1;
+    }
+
+    fuzzer->cpu = fuzzer->base;
+    fuzzer->cpu.coverage = fuzzer->map;
+
+    // Seed the corpus with the guest's own initial state
+    FuzzInput *seed_input = &fuzzer->corpus[0];
+    memset(seed_input, 0, sizeof(FuzzInput));
+    seed_input->size = FUZZ_REGS + fuzzer->window_size;
+    memcpy(seed_input->data, base->regs, FUZZ_REGS);
+    memcpy(seed_input->data + FUZZ_REGS, &base->memory[window_offset], fuzzer->window_size);
+    fuzzer->corpus_size = 1;
+    return 0;
+}
+
+void free_fuzzer(Fuzzer *fuzzer)
+{
+    free(fuzzer->map);
+    free(fuzzer->virgin);
+    free(fuzzer->corpus);
+    fuzzer->map = NULL;
+    fuzzer->virgin = NULL;
+    fuzzer->corpus = NULL;
+}
+
+// Put back only the state a guest can change or observe. The opcode
+// histogram is left to accumulate across inputs.
+static void reset_guest(CPU *cpu, const CPU *base)
+{
+    memcpy(cpu->regs, base->regs, sizeof(cpu->regs));
+    cpu->si = base->si;
+    cpu->di = base->di;
+    cpu->ip = base->ip;
+    cpu->sp = base->sp;
+    cpu->flags = base->flags;
+    cpu->halted = false;
+    cpu->fault = FAULT_NONE;
+    memcpy(cpu->memory, base->memory, MEMORY_SIZE);
+    cpu->icache = base->icache;
+    memcpy(cpu->counters.values, base->counters.values, sizeof(cpu->counters.values));
+}
+
+static void record_crash(Fuzzer *fuzzer, const FuzzInput *input)
+{
+    fuzzer->total_crashes++;
+    for (uint32_t i = 0; i < fuzzer->num_crashes; i++)
+    {
+        if (fuzzer->crashes[i].fault == fuzzer->cpu.fault &&
+            fuzzer->crashes[i].ip == fuzzer->cpu.fault_ip)
+        {
+            return;
+        }
+    }
+
+    if (fuzzer->num_crashes < FUZZ_MAX_CRASHES)
+    {
+        FuzzCrash *crash = &fuzzer->crashes[fuzzer->num_crashes++];
+        crash->fault = fuzzer->cpu.fault;
+        crash->ip = fuzzer->cpu.fault_ip;
+        if (crash->fault == FAULT_INVALID_OPCODE)
+        {
+            memcpy(crash->opcode, fuzzer->cpu.fault_opcode, sizeof(crash->opcode));
+            crash->opcode_length = fuzzer->cpu.fault_opcode_length;
+        }
+        crash->input = *input;
+    }
+}
+
+// Only the edges this run touched are examined and cleared
+static bool update_coverage(Fuzzer *fuzzer)
+{
+    CoverageMap *map = fuzzer->map;
+    bool new_coverage = false;
+
+    for (uint32_t i = 0; i < map->num_touched; i++)
+    {
+        uint16_t edge = map->touched[i];
+        uint8_t bucket = count_bucket(map->hits[edge]);
+        if (!(fuzzer->virgin[edge] & bucket))
+        {
+            if (fuzzer->virgin[edge] == 0)
+            {
+                fuzzer->edges++;
+            }
+            fuzzer->virgin[edge] |= bucket;
+            new_coverage = true;
+        }
+    }
+
+    coverage_reset(map);
+    return new_coverage;
+}
+
+// Run one input from the pristine state. Faults are reported as crashes and
+// running past max_steps as a hang; neither stops the fuzzer.
+FuzzResult fuzz_execute(Fuzzer *fuzzer, const FuzzInput *input, bool *new_coverage)
+{
+    CPU *cpu = &fuzzer->cpu;
+    reset_guest(cpu, &fuzzer->base);
+    memcpy(cpu->regs, input->data, FUZZ_REGS);
+    memcpy(&cpu->memory[fuzzer->window_offset], input->data + FUZZ_REGS, input->size - FUZZ_REGS);
+
+    uint32_t steps = 0;
+    while (!cpu->halted && steps++ < fuzzer->max_steps)
+    {
+        execute(cpu, false);
+    }
+    fuzzer->execs++;
+
+    *new_coverage = update_coverage(fuzzer);
+
+    if (cpu->fault)
+    {
+        record_crash(fuzzer, input);
+        return FUZZ_CRASH;
+    }
+    if (!cpu->halted)
+    {
+        fuzzer->hangs++;
+        return FUZZ_HANG;
+    }
+    return FUZZ_OK;
+}
+
+// A stack of 2-16 havoc-style edits
+void fuzz_mutate(Fuzzer *fuzzer, FuzzInput *input)
+{
+    uint32_t edits = 2 << random_below(fuzzer, 4);
+
+    for (uint32_t i = 0; i < edits; i++)
+    {
+        uint32_t pos = random_below(fuzzer, input->size);
+        switch (random_below(fuzzer, 6))
+        {
+        case 0: // Flip a bit
+            input->data[pos] ^= 1 << random_below(fuzzer, 8);
+            break;
+        case 1: // Interesting value
+            input->data[pos] = interesting_values[random_below(fuzzer, sizeof(interesting_values))];
+            break;
+        case 2: // Small add/subtract
+        {
+            uint8_t delta = 1 + random_below(fuzzer, 35);
+            input->data[pos] += random_below(fuzzer, 2) ? delta : -delta;
+        }
+        break;
+        case 3: // Random byte
+            input->data[pos] = next_random(fuzzer);
+            break;
+        case 4: // Copy a byte from elsewhere in the input
+            input->data[pos] = input->data[random_below(fuzzer, input->size)];
+            break;
+        case 5: // Splice a run from another corpus entry
+        {
+            const FuzzInput *other = &fuzzer->corpus[random_below(fuzzer, fuzzer->corpus_size)];
+            uint32_t len = 1 + random_below(fuzzer, input->size - pos);
+            memcpy(&input->data[pos], &other->data[pos], len);
+        }
+        break;
+        }
+    }
+}
+
+// Mutate a corpus entry, run it and keep it if it reached new coverage
+FuzzResult fuzz_one(Fuzzer *fuzzer)
+{
+    FuzzInput input = fuzzer->corpus[random_below(fuzzer, fuzzer->corpus_size)];
+    fuzz_mutate(fuzzer, &input);
+
+    bool new_coverage;
+    FuzzResult result = fuzz_execute(fuzzer, &input, &new_coverage);
+
+    if (new_coverage && result == FUZZ_OK)
+    {
+        // Once full, replace a random entry other than the seed
+        uint32_t slot = fuzzer->corpus_size < FUZZ_MAX_CORPUS
+                            ? fuzzer->corpus_size++
+                            : 1 + random_below(fuzzer, FUZZ_MAX_CORPUS - 1);
+        fuzzer->corpus[slot] = input;
+    }
+    return result;
+}
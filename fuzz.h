@@ -0,0 +1,71 @@
+#ifndef CPU_FUZZ_H
+#define CPU_FUZZ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tiny_x86.h"
+#include "coverage.h"
+
+#define FUZZ_REGS 8
+#define FUZZ_MAX_INPUT (FUZZ_REGS + MEMORY_SIZE)
+#define FUZZ_MAX_CORPUS 1024
+#define FUZZ_MAX_CRASHES 64
+#define FUZZ_DEFAULT_STEPS 10000
+
+typedef enum
+{
+    FUZZ_OK,
+    FUZZ_CRASH,
+    FUZZ_HANG
+} FuzzResult;
+
+// Initial register values (CPU.regs order) followed by the bytes written to
+// the fuzzed memory window
+typedef struct
+{
+    uint8_t data[FUZZ_MAX_INPUT];
+    uint16_t size;
+} FuzzInput;
+
+// First input seen for each distinct (fault, IP) pair
+typedef struct
+{
+    uint8_t fault;
+    uint8_t ip;
+    uint8_t opcode[2];     // Decoded bytes, for FAULT_INVALID_OPCODE
+    uint8_t opcode_length; // 0 for other faults
+    FuzzInput input;
+} FuzzCrash;
+
+typedef struct
+{
+    CPU base; // Pristine guest every input starts from
+    CPU cpu;
+    uint8_t window_offset;
+    uint16_t window_size;
+    uint32_t max_steps;
+    uint64_t rng;
+
+    CoverageMap *map;
+    uint8_t *virgin; // Hit-count buckets seen so far, per edge
+    uint32_t edges;
+
+    FuzzInput *corpus;
+    uint32_t corpus_size;
+    FuzzCrash crashes[FUZZ_MAX_CRASHES];
+    uint32_t num_crashes;
+
+    uint64_t execs;
+    uint64_t total_crashes;
+    uint64_t hangs;
+} Fuzzer;
+
+int init_fuzzer(Fuzzer *fuzzer, const CPU *base, uint8_t window_offset,
+                uint16_t window_size, uint64_t seed);
+void free_fuzzer(Fuzzer *fuzzer);
+
+FuzzResult fuzz_execute(Fuzzer *fuzzer, const FuzzInput *input, bool *new_coverage);
+void fuzz_mutate(Fuzzer *fuzzer, FuzzInput *input);
+FuzzResult fuzz_one(Fuzzer *fuzzer);
+
+#endif
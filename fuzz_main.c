@@ -0,0 +1,170 @@
+#include "tiny_x86.h"
+#include "bundle.h"
+#include "fuzz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#define STATUS_INTERVAL 65536
+
+static const char *fault_name(uint8_t fault)
+{
+    return fault == FAULT_DIVIDE_ERROR ? "division by zero" : "unknown opcode";
+}
+
+// "offset:size" for a window that lies inside guest memory
+static bool parse_window(const char *text, unsigned *offset, unsigned *size)
+{
+    char *end;
+    if (*text < '0' || *text > '9')
+    {
+        return false;
+    }
+    unsigned long start = strtoul(text, &end, 0);
+    if (*end != ':' || start >= MEMORY_SIZE || end[1] < '0' || end[1] > '9')
+    {
+        return false;
+    }
+    unsigned long length = strtoul(end + 1, &end, 0);
+    if (*end != '\0' || length > MEMORY_SIZE - start)
+    {
+        return false;
+    }
+    *offset = start;
+    *size = length;
+    return true;
+}
+
+// Wall-clock seconds, so exec/sec is not skewed by time spent off the CPU
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_status(const Fuzzer *fuzzer, double start)
+{
+    double seconds = now_seconds() - start;
+    printf("execs: %" PRIu64 "  exec/sec: %.0f  corpus: %u  edges: %u  "
+           "crashes: %u unique (%" PRIu64 " total)  hangs: %" PRIu64 "\n",
+           fuzzer->execs, seconds > 0 ? fuzzer->execs / seconds : 0.0,
+           fuzzer->corpus_size, fuzzer->edges, fuzzer->num_crashes,
+           fuzzer->total_crashes, fuzzer->hangs);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long max_execs = 1000000, seed = 1, max_steps = FUZZ_DEFAULT_STEPS;
+    unsigned window_offset = 0, window_size = 0;
+    unsigned long long bundle_index = 0;
+    bool use_bundle = false;
+    const char *program = NULL;
+    bool bad_args = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--execs") == 0 && has_value)
+            bad_args |= !parse_count(argv[++i], &max_execs);
+        else if (strcmp(argv[i], "--seed") == 0 && has_value)
+            bad_args |= !parse_count(argv[++i], &seed);
+        else if (strcmp(argv[i], "--steps") == 0 && has_value)
+            bad_args |= !parse_count(argv[++i], &max_steps) || max_steps == 0 || max_steps > UINT32_MAX;
+        else if (strcmp(argv[i], "--mem") == 0 && has_value)
+            bad_args |= !parse_window(argv[++i], &window_offset, &window_size);
+        else if (strcmp(argv[i], "--bundle") == 0 && has_value)
+        {
+            use_bundle = true;
+            bad_args |= !parse_count(argv[++i], &bundle_index);
+        }
+        else if (!program)
+            program = argv[i];
+        else
+            bad_args = true;
+    }
+    if (!program || bad_args)
+    {
+        printf("Usage: %s [--execs N] [--seed S] [--steps N] [--mem offset:size] "
+               "[--bundle <index>] <program.bin|bundle>\n",
+               argv[0]);
+        return 1;
+    }
+
+    CPU base;
+    init_cpu(&base);
+    if (use_bundle)
+    {
+        Bundle bundle;
+        if (open_bundle(&bundle, program) != 0)
+        {
+            return 1;
+        }
+        int loaded = bundle_index < bundle.count ? load_bundle_program(&bundle, bundle_index, &base) : -1;
+        close_bundle(&bundle);
+        if (loaded != 0)
+        {
+            printf("Bundle has no guest %llu\n", bundle_index);
+            return 1;
+        }
+    }
+    else
+    {
+        int size = load_program(&base, program, false);
+        if (size < 0)
+        {
+            return 1;
+        }
+        printf("Loaded %d bytes into memory\n", size);
+    }
+
+    Fuzzer fuzzer;
+    if (init_fuzzer(&fuzzer, &base, window_offset, window_size, seed) != 0)
+    {
+        printf("Failed to allocate fuzzer state\n");
+        return 1;
+    }
+    fuzzer.max_steps = max_steps;
+    printf("Fuzzing registers and %u bytes of memory at 0x%02X\n",
+           fuzzer.window_size, fuzzer.window_offset);
+
+    // Dry run of the seed to record its baseline coverage
+    bool new_coverage;
+    fuzz_execute(&fuzzer, &fuzzer.corpus[0], &new_coverage);
+
+    double start = now_seconds();
+    uint32_t last_edges = fuzzer.edges, last_crashes = 0;
+    while (fuzzer.execs < max_execs)
+    {
+        fuzz_one(&fuzzer);
+        if (fuzzer.edges != last_edges || fuzzer.num_crashes != last_crashes ||
+            fuzzer.execs % STATUS_INTERVAL == 0)
+        {
+            last_edges = fuzzer.edges;
+            last_crashes = fuzzer.num_crashes;
+            print_status(&fuzzer, start);
+        }
+    }
+    print_status(&fuzzer, start);
+
+    for (uint32_t i = 0; i < fuzzer.num_crashes; i++)
+    {
+        const FuzzCrash *crash = &fuzzer.crashes[i];
+        printf("Crash: %s", fault_name(crash->fault));
+        for (int j = 0; j < crash->opcode_length; j++)
+        {
+            printf(" 0x%02X", crash->opcode[j]);
+        }
+        printf(" at IP 0x%02X, input:", crash->ip);
+        for (int j = 0; j < crash->input.size; j++)
+        {
+            printf(" %02X", crash->input.data[j]);
+        }
+        printf("\n");
+    }
+
+    free_fuzzer(&fuzzer);
+    return fuzzer.num_crashes > 0 ? 2 : 0;
+}
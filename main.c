@@ -1,23 +1,211 @@
 #include "tiny_x86.h"
+#include "analysis.h"
+#include "bundle.h"
+#include "debugger.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+// --pack: bundle flat images, each starting from the state a plain run of
+// that image would start from
+static int pack_bundle(const char *path, char *const *images, int count)
+{
+    CPU *guests = malloc(count * sizeof(CPU));
+    uint16_t *sizes = malloc(count * sizeof(uint16_t));
+    int result = guests && sizes ? 0 : -1;
+
+    for (int i = 0; i < count && result == 0; i++)
+    {
+        init_cpu(&guests[i]);
+        int size = load_program(&guests[i], images[i], false);
+        result = size < 0 ? -1 : 0;
+        sizes[i] = size;
+    }
+    if (result == 0)
+    {
+        result = save_bundle(path, guests, sizes, count);
+    }
+    if (result == 0)
+    {
+        printf("Packed %d images into %s\n", count, path);
+    }
+
+    free(guests);
+    free(sizes);
+    return result;
+}
+
+typedef struct
+{
+    bool json;
+    bool failed;
+} GuestReport;
+
+// --bundle all: a line per guest, or a JSON object per line with --json
+static void report_guest(uint32_t index, const CPU *cpu, void *context)
+{
+    GuestReport *report = context;
+    report->failed |= cpu->fault != FAULT_NONE || !cpu->halted;
+    if (report->json)
+    {
+        export_counters_json(cpu, stdout);
+    }
+    else if (cpu->fault)
+    {
+        printf("Guest %u: ", index);
+        print_fault(cpu);
+    }
+    else if (!cpu->halted)
+    {
+        printf("Guest %u: no HLT after %" PRIu64 " instructions, stopped at IP 0x%02X\n",
+               index, cpu->counters.values[CTR_INSTRUCTIONS], cpu->ip);
+    }
+    else
+    {
+        printf("Guest %u: halted at IP 0x%02X, AL=0x%02X after %" PRIu64 " instructions\n",
+               index, cpu->ip, cpu->al, cpu->counters.values[CTR_INSTRUCTIONS]);
+    }
+}
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    // --json/--csv export the performance counters after the program halts; --bundle N
+    // runs guest N of a bundle file instead of a flat .bin, and --bundle all
+    // runs every guest on --jobs threads sharing the mapping, each stopped
+    // after --steps instructions; --record N opens
+    // the time-travel debugger with a checkpoint every N instructions;
+    // --analyze prints the static block analysis
+    bool json = false, csv = false, analyze = false, bad_args = false;
+    bool use_bundle = false, all_guests = false, limit_steps = false;
+    unsigned long long record_interval = 0, record_budget = DEFAULT_CHECKPOINT_BUDGET;
+    unsigned long long bundle_index = 0, jobs = 1, steps = BUNDLE_DEFAULT_STEPS;
+    const char *program = NULL;
+
+    if (argc >= 4 && strcmp(argv[1], "--pack") == 0)
+    {
+        return pack_bundle(argv[2], argv + 3, argc - 3) == 0 ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (strcmp(argv[i], "--analyze") == 0)
+            analyze = true;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            bad_args |= !parse_count(argv[++i], &record_interval) || record_interval == 0;
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+            bad_args |= !parse_count(argv[++i], &record_budget);
+        else if (strcmp(argv[i], "--bundle") == 0 && i + 1 < argc)
+        {
+            use_bundle = true;
+            all_guests = strcmp(argv[++i], "all") == 0;
+            bad_args |= !all_guests && !parse_count(argv[i], &bundle_index);
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+            bad_args |= !parse_count(argv[++i], &jobs) || jobs == 0 || jobs > MAX_BUNDLE_WORKERS;
+        else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+        {
+            limit_steps = true;
+            bad_args |= !parse_count(argv[++i], &steps) || steps == 0;
+        }
+        else if (!program)
+            program = argv[i];
+        else
+            bad_args = true;
+    }
+    // A whole-bundle run only reports per-guest results
+    bad_args |= all_guests && (csv || analyze || record_interval);
+    bad_args |= limit_steps && !all_guests;
+    // The debugger console replaces the normal run and its output
+    bad_args |= record_interval && (json || csv || analyze);
+    if (!program || bad_args)
     {
-        printf("Usage: %s <program.bin>\n", argv[0]);
+        printf("Usage: %s [--json|--csv] [--analyze] [--bundle <index>]\n"
+               "       [--record <interval> [--budget <bytes>]] <program.bin|bundle>\n"
+               "       %s [--json] [--jobs <threads>] [--steps <limit>] --bundle all <bundle>\n"
+               "       %s --pack <out.tbundle> <program.bin>...\n",
+               argv[0], argv[0], argv[0]);
         return 1;
     }
 
     CPU cpu;
     init_cpu(&cpu);
 
+    // An export format owns stdout, so skip the human-readable output
     bool verbose = false;
-    if (load_program(&cpu, argv[1], verbose) != 0)
+    bool human = !json && !csv;
+    if (use_bundle)
     {
-        return 1;
+        Bundle bundle;
+        if (open_bundle(&bundle, program) != 0)
+        {
+            return 1;
+        }
+        if (all_guests)
+        {
+            GuestReport report = {.json = json};
+            int result = run_bundle(&bundle, jobs, steps, report_guest, &report);
+            close_bundle(&bundle);
+            return result != 0 || report.failed ? 1 : 0;
+        }
+        if (bundle_index >= bundle.count ||
+            load_bundle_program(&bundle, bundle_index, &cpu) != 0)
+        {
+            printf("Bundle has no guest %llu (%u guests)\n", bundle_index, bundle.count);
+            close_bundle(&bundle);
+            return 1;
+        }
+        close_bundle(&bundle);
+    }
+    else
+    {
+        int size = load_program(&cpu, program, verbose);
+        if (size < 0)
+        {
+            return 1;
+        }
+        if (human)
+        {
+            printf("Loaded %d bytes into memory\n", size);
+        }
+    }
+
+    if (analyze && human)
+    {
+        ProgramAnalysis analysis;
+        analyze_program(&analysis, cpu.memory, cpu.ip);
+        printf("Analysis: %u instructions in %u blocks\n", analysis.num_insns, analysis.num_blocks);
+    }
+
+    if (record_interval)
+    {
+        Debugger dbg;
+        if (init_debugger(&dbg, &cpu, record_interval, record_budget) != 0)
+        {
+            printf("Checkpoint budget too small (need at least %zu bytes)\n", 2 * sizeof(Checkpoint));
+            return 1;
+        }
+        run_debugger_console(&dbg, stdin, stdout);
+        free_debugger(&dbg);
+        return 0;
+    }
+
+    while (!cpu.halted)
+    {
+        execute(&cpu, verbose);
     }
 
-    run_cpu(&cpu, verbose);
-    return 0;
-}
\ No newline at end of file
+    if (json)
+        export_counters_json(&cpu, stdout);
+    else if (csv)
+        export_counters_csv(&cpu, stdout);
+    else if (cpu.fault)
+        print_fault(&cpu);
+    else
+        print_cpu_state(&cpu);
+    return cpu.fault ? 1 : 0;
+}
@@ -1,4 +1,8 @@
 #include "tiny_x86.h"
+#include "debugger.h"
+#include "analysis.h"
+#include "bundle.h"
+#include "fuzz.h"
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
@@ -242,6 +246,529 @@ void test_flags()
     print_test_result("Sign Flag set on negative result", (cpu.flags & FLAG_SIGN) != 0);
 }
 
+void test_string_ops()
+{
+    CPU cpu;
+    reset_cpu(&cpu);
+
+    // Test REP MOVSB
+    uint8_t movs_program[] = {0xBE, 0x40, 0x00, // MOV SI, 0x40
+                              0xBF, 0x80, 0x00, // MOV DI, 0x80
+                              0xB9, 0x10, 0x00, // MOV CX, 16
+                              0xF3, 0xA4,       // REP MOVSB
+                              0xF4};
+    memcpy(cpu.memory, movs_program, sizeof(movs_program));
+    for (int i = 0; i < 16; i++)
+    {
+        cpu.memory[0x40 + i] = i + 1;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        execute_non_verbose(&cpu);
+    }
+    print_test_result("REP MOVSB",
+                      memcmp(&cpu.memory[0x80], &cpu.memory[0x40], 16) == 0 &&
+                          cpu.si == 0x50 && cpu.di == 0x90 && cpu.cl == 0 && cpu.ch == 0);
+    print_test_result("REP MOVSB counted as MOVSB",
+                      cpu.counters.opcodes[0xA4] == 1 && cpu.counters.opcodes[PREFIX_REP] == 0);
+
+    // Overlapping forward copy replicates the first byte, as a byte loop would
+    reset_cpu(&cpu);
+    uint8_t smear_program[] = {0xBE, 0x40, 0x00, // MOV SI, 0x40
+                               0xBF, 0x41, 0x00, // MOV DI, 0x41
+                               0xB9, 0x08, 0x00, // MOV CX, 8
+                               0xF3, 0xA4,       // REP MOVSB
+                               0xF4};
+    memcpy(cpu.memory, smear_program, sizeof(smear_program));
+    cpu.memory[0x40] = 0x5A;
+    for (int i = 0; i < 4; i++)
+    {
+        execute_non_verbose(&cpu);
+    }
+    bool smeared = true;
+    for (int i = 0; i <= 8; i++)
+    {
+        smeared = smeared && cpu.memory[0x40 + i] == 0x5A;
+    }
+    print_test_result("REP MOVSB overlapping", smeared);
+
+    // Test REP STOSB backwards
+    reset_cpu(&cpu);
+    uint8_t stos_program[] = {0xB0, 0xEE,       // MOV AL, 0xEE
+                              0xBF, 0x87, 0x00, // MOV DI, 0x87
+                              0xB9, 0x08, 0x00, // MOV CX, 8
+                              0xFD,             // STD
+                              0xF3, 0xAA,       // REP STOSB
+                              0xF4};
+    memcpy(cpu.memory, stos_program, sizeof(stos_program));
+    for (int i = 0; i < 5; i++)
+    {
+        execute_non_verbose(&cpu);
+    }
+    print_test_result("REP STOSB with STD",
+                      cpu.memory[0x80] == 0xEE && cpu.memory[0x87] == 0xEE &&
+                          cpu.memory[0x7F] == 0x00 && cpu.memory[0x88] == 0x00 &&
+                          cpu.di == 0x7F);
+
+    // Test REPE CMPSB stopping at the first difference
+    reset_cpu(&cpu);
+    uint8_t cmps_program[] = {0xBE, 0x40, 0x00, // MOV SI, 0x40
+                              0xBF, 0x80, 0x00, // MOV DI, 0x80
+                              0xB9, 0x10, 0x00, // MOV CX, 16
+                              0xF3, 0xA6,       // REPE CMPSB
+                              0xF4};
+    memcpy(cpu.memory, cmps_program, sizeof(cmps_program));
+    memcpy(&cpu.memory[0x40], "abcdefgh", 8);
+    memcpy(&cpu.memory[0x80], "abcdXfgh", 8);
+    for (int i = 0; i < 4; i++)
+    {
+        execute_non_verbose(&cpu);
+    }
+    print_test_result("REPE CMPSB",
+                      !(cpu.flags & FLAG_ZERO) && cpu.cl == 11 &&
+                          cpu.si == 0x45 && cpu.di == 0x85);
+
+    // Test LODSB
+    reset_cpu(&cpu);
+    uint8_t lods_program[] = {0xBE, 0x40, 0x00, // MOV SI, 0x40
+                              0xAC,             // LODSB
+                              0xF4};
+    memcpy(cpu.memory, lods_program, sizeof(lods_program));
+    cpu.memory[0x40] = 0x99;
+    execute_non_verbose(&cpu);
+    execute_non_verbose(&cpu);
+    print_test_result("LODSB", cpu.al == 0x99 && cpu.si == 0x41);
+}
+
+// Run REP `op` once and `count` plain `op`s from the same state, with the
+// code at `code_at`, and check both leave memory, SI, DI and flags alike
+bool rep_matches_loop(uint8_t op, uint8_t si, uint8_t di, uint8_t count, bool backward,
+                      uint8_t code_at)
+{
+    CPU rep, loop;
+    reset_cpu(&rep);
+    for (int i = 0; i < MEMORY_SIZE; i++)
+    {
+        rep.memory[i] = i * 7 + 3;
+    }
+    rep.al = 0xA5;
+    rep.si = si;
+    rep.di = di;
+    rep.flags = backward ? FLAG_DIRECTION : 0;
+    loop = rep;
+
+    rep.memory[code_at] = PREFIX_REP;
+    rep.memory[(uint8_t)(code_at + 1)] = op;
+    rep.ip = code_at;
+    rep.cl = count;
+    execute_non_verbose(&rep);
+
+    for (int i = 0; i < count; i++)
+    {
+        loop.memory[(uint8_t)(code_at + i)] = op;
+    }
+    loop.ip = code_at;
+    for (int i = 0; i < count; i++)
+    {
+        execute_non_verbose(&loop);
+    }
+
+    // Code bytes differ between the two, so skip them
+    for (int i = 0; i < count; i++)
+    {
+        rep.memory[(uint8_t)(code_at + i)] = loop.memory[(uint8_t)(code_at + i)] = 0;
+    }
+    return memcmp(rep.memory, loop.memory, MEMORY_SIZE) == 0 &&
+           rep.si == loop.si && rep.di == loop.di && rep.flags == loop.flags && rep.cl == 0;
+}
+
+// REPE CMPSB over two 40-byte buffers that differ only at `mismatch`
+// (40 for none) must stop just past it, in either direction
+bool repe_stops_at(int mismatch, bool backward)
+{
+    CPU cpu;
+    reset_cpu(&cpu);
+    for (int i = 0; i < 40; i++)
+    {
+        cpu.memory[0x40 + i] = cpu.memory[0x90 + i] = i * 5 + 1;
+    }
+    int offset = backward ? 39 - mismatch : mismatch;
+    if (mismatch < 40)
+    {
+        cpu.memory[0x90 + offset] ^= 0x10;
+    }
+    cpu.memory[0] = PREFIX_REP;
+    cpu.memory[1] = 0xA6;
+    cpu.si = backward ? 0x40 + 39 : 0x40;
+    cpu.di = backward ? 0x90 + 39 : 0x90;
+    cpu.flags = backward ? FLAG_DIRECTION : 0;
+    cpu.cl = 40;
+    execute_non_verbose(&cpu);
+
+    int done = mismatch < 40 ? mismatch + 1 : 40;
+    int step = backward ? -1 : 1;
+    return cpu.cl == 40 - done && cpu.si == (uint8_t)((backward ? 0x40 + 39 : 0x40) + done * step) &&
+           (mismatch < 40) == !(cpu.flags & FLAG_ZERO);
+}
+
+void test_string_edge_cases()
+{
+    CPU cpu;
+    reset_cpu(&cpu);
+
+    // Test REPNE CMPSB stopping at the first match
+    uint8_t repne_program[] = {0xBE, 0x40, 0x00, // MOV SI, 0x40
+                               0xBF, 0x80, 0x00, // MOV DI, 0x80
+                               0xB9, 0x10, 0x00, // MOV CX, 16
+                               0xF2, 0xA6,       // REPNE CMPSB
+                               0xF4};
+    memcpy(cpu.memory, repne_program, sizeof(repne_program));
+    memcpy(&cpu.memory[0x40], "abcdefgh", 8);
+    memcpy(&cpu.memory[0x80], "ABCDeFGH", 8);
+    for (int i = 0; i < 4; i++)
+    {
+        execute_non_verbose(&cpu);
+    }
+    print_test_result("REPNE CMPSB",
+                      (cpu.flags & FLAG_ZERO) && cpu.cl == 11 &&
+                          cpu.si == 0x45 && cpu.di == 0x85);
+
+    // Test REP with CX = 0
+    reset_cpu(&cpu);
+    uint8_t zero_program[] = {0xF3, 0xA6, // REPE CMPSB
+                              0xF3, 0xA4, // REP MOVSB
+                              0xF4};
+    memcpy(cpu.memory, zero_program, sizeof(zero_program));
+    cpu.memory[0x40] = 0x11;
+    cpu.si = 0x40;
+    cpu.di = 0x80;
+    cpu.flags = FLAG_SIGN;
+    execute_non_verbose(&cpu);
+    execute_non_verbose(&cpu);
+    print_test_result("REP with CX = 0 is a no-op",
+                      cpu.flags == FLAG_SIGN && cpu.si == 0x40 && cpu.di == 0x80 &&
+                          cpu.cl == 0 && cpu.ch == 0 && cpu.memory[0x80] == 0 && cpu.ip == 4);
+
+    print_test_result("REP MOVSB wrapping source",
+                      rep_matches_loop(0xA4, 0xF8, 0x20, 16, false, 0x80));
+    print_test_result("REP MOVSB overlapping across wrap",
+                      rep_matches_loop(0xA4, 0xFC, 0xFE, 8, false, 0x80));
+    print_test_result("REP MOVSB backward, destination below",
+                      rep_matches_loop(0xA4, 0x49, 0x46, 8, true, 0x80));
+    print_test_result("REP MOVSB backward, destination above",
+                      rep_matches_loop(0xA4, 0x46, 0x49, 8, true, 0x80));
+    print_test_result("REP STOSB wrapping backward",
+                      rep_matches_loop(0xAA, 0x00, 0x03, 8, true, 0x80));
+    print_test_result("REP STOSB wrapping forward",
+                      rep_matches_loop(0xAA, 0x00, 0xFC, 8, false, 0x80));
+
+    bool repe_ok = true;
+    for (int mismatch = 0; mismatch <= 40; mismatch++)
+    {
+        repe_ok &= repe_stops_at(mismatch, false) && repe_stops_at(mismatch, true);
+    }
+    print_test_result("REPE CMPSB stops at every mismatch", repe_ok);
+}
+
+void load_countdown(CPU *cpu)
+{
+    reset_cpu(cpu);
+    uint8_t program[] = {0xB1, 0xC8, // MOV CL, 200
+                         0xFE, 0xC9, // DEC CL
+                         0x75, 0xFC, // JNE -4
+                         0xF4};
+    memcpy(cpu->memory, program, sizeof(program));
+}
+
+void test_time_travel()
+{
+    CPU cpu, reference;
+    Debugger dbg;
+    load_countdown(&cpu);
+    init_debugger(&dbg, &cpu, 16, 8 * sizeof(Checkpoint));
+
+    // MOV + 200 * (DEC + JNE) + HLT
+    uint64_t executed = debugger_continue(&dbg, false, 0, false);
+    print_test_result("Record until halt", cpu.halted && executed == 402);
+    print_test_result("Checkpoints within budget", dbg.count <= 8 && dbg.interval > 16);
+
+    debugger_seek(&dbg, 101);
+    load_countdown(&reference);
+    for (int i = 0; i < 101; i++)
+    {
+        execute_non_verbose(&reference);
+    }
+    print_test_result("Seek matches straight execution",
+                      cpu.cl == reference.cl && cpu.ip == reference.ip &&
+                          cpu.flags == reference.flags && !cpu.halted &&
+                          cpu.icache.hits == reference.icache.hits &&
+                          cpu.icache.misses == reference.icache.misses);
+
+    debugger_seek(&dbg, 402);
+    debugger_reverse_step(&dbg);
+    print_test_result("Reverse step onto HLT",
+                      dbg.icount == 401 && !cpu.halted && cpu.ip == 0x06);
+
+    bool found = debugger_reverse_continue(&dbg, 0x02);
+    print_test_result("Reverse continue to breakpoint",
+                      found && dbg.icount == 399 && cpu.ip == 0x02 && cpu.cl == 1);
+
+    found = debugger_reverse_continue(&dbg, 0x10);
+    print_test_result("Reverse continue without hit stays put",
+                      !found && dbg.icount == 399);
+
+    debugger_seek(&dbg, 0);
+    debugger_continue(&dbg, true, 0x02, false);
+    print_test_result("Continue stops at breakpoint", dbg.icount == 1 && cpu.ip == 0x02);
+
+    FILE *script = tmpfile();
+    fputs("seek 10\nrs\nc 0x06\nq\n", script);
+    rewind(script);
+    FILE *transcript = tmpfile();
+    run_debugger_console(&dbg, script, transcript);
+    fclose(script);
+    fclose(transcript);
+    print_test_result("Debugger console commands", dbg.icount == 401 && cpu.ip == 0x06);
+
+    script = tmpfile();
+    fputs("seek 10\nrs\nseek -1\nc x\nq\n", script);
+    rewind(script);
+    transcript = tmpfile();
+    run_debugger_console(&dbg, script, transcript);
+    fclose(script);
+    fclose(transcript);
+    print_test_result("Debugger console rejects bad arguments", dbg.icount == 9);
+
+    free_debugger(&dbg);
+}
+
+void test_analysis()
+{
+    CPU cpu;
+    load_countdown(&cpu);
+
+    ProgramAnalysis analysis;
+    analyze_program(&analysis, cpu.memory, 0);
+    // Blocks: MOV, DEC/JNE loop body, HLT
+    print_test_result("Analysis finds blocks",
+                      analysis.num_insns == 4 && analysis.num_blocks == 3 &&
+                          (analysis.flags[0x02] & INSN_LEADER) && analysis.target[0x04] == 0x02);
+}
+
+void test_counters()
+{
+    CPU cpu;
+    reset_cpu(&cpu);
+
+    uint8_t program[] = {0xE8, 0x05, 0x00, // CALL +5
+                         0x0F, 0x31,       // RDTSC
+                         0xEB, 0x02,       // JMP +2
+                         0x50,             // PUSH AX
+                         0xC3,             // RET
+                         0xB1, 0x05,       // MOV CL, CTR_RETURNS
+                         0x0F, 0x33,       // RDPMC
+                         0xF4};
+    memcpy(cpu.memory, program, sizeof(program));
+    // JMP +2 from 0x05 skips to 0x09, so the CALL target at 0x08 is just RET
+    while (!cpu.halted)
+    {
+        execute_non_verbose(&cpu);
+    }
+
+    print_test_result("Counters track control flow",
+                      read_counter(&cpu, CTR_INSTRUCTIONS) == 7 &&
+                          read_counter(&cpu, CTR_CALLS) == 1 &&
+                          read_counter(&cpu, CTR_RETURNS) == 1 &&
+                          read_counter(&cpu, CTR_BRANCHES_TAKEN) == 1 &&
+                          read_counter(&cpu, CTR_STACK_HIGH_WATER) == 1 &&
+                          cpu.counters.opcodes[0x0F] == 0 && cpu.counters.opcodes_0f[0x31] == 1 &&
+                          cpu.counters.opcodes_0f[0x33] == 1);
+    print_test_result("RDPMC reads counter into DX:AX",
+                      cpu.al == 1 && cpu.ah == 0 && cpu.dl == 0 && cpu.dh == 0);
+    print_test_result("Icache counters are 64-bit",
+                      sizeof(cpu.icache.hits) == 8 &&
+                          read_counter(&cpu, CTR_ICACHE_HITS) + read_counter(&cpu, CTR_ICACHE_MISSES) == 13);
+
+    char buffer[2048] = {0};
+    FILE *out = tmpfile();
+    export_counters_json(&cpu, out);
+    rewind(out);
+    fread(buffer, 1, sizeof(buffer) - 1, out);
+    fclose(out);
+    print_test_result("Counters export as JSON",
+                      strstr(buffer, "\"calls\": 1") && strstr(buffer, "\"0x0F31\": 1"));
+
+    memset(buffer, 0, sizeof(buffer));
+    out = tmpfile();
+    export_counters_csv(&cpu, out);
+    rewind(out);
+    fread(buffer, 1, sizeof(buffer) - 1, out);
+    fclose(out);
+    print_test_result("Counters export as CSV",
+                      strncmp(buffer, "counter,value\n", 14) == 0 && strstr(buffer, "returns,1\n"));
+}
+
+void test_faults()
+{
+    CPU cpu;
+    reset_cpu(&cpu);
+    uint8_t program[] = {0xB0, 0x01, // MOV AL, 1
+                         0x0F, 0x0B}; // UD2
+    memcpy(cpu.memory, program, sizeof(program));
+    while (!cpu.halted)
+    {
+        execute_non_verbose(&cpu);
+    }
+    print_test_result("Fault keeps both 0F opcode bytes",
+                      cpu.fault == FAULT_INVALID_OPCODE && cpu.fault_ip == 0x02 &&
+                          cpu.fault_opcode_length == 2 && cpu.fault_opcode[0] == 0x0F &&
+                          cpu.fault_opcode[1] == 0x0B);
+    print_test_result("Faulting instruction does not retire",
+                      read_counter(&cpu, CTR_INSTRUCTIONS) == 1 &&
+                          cpu.counters.opcodes[0x0F] == 0 && cpu.counters.opcodes_0f[0x0B] == 0);
+
+    reset_cpu(&cpu);
+    cpu.memory[0] = PREFIX_REP;
+    cpu.memory[1] = 0x90; // REP NOP is not a string op
+    execute_non_verbose(&cpu);
+    print_test_result("Fault keeps REP prefix and opcode",
+                      cpu.fault == FAULT_INVALID_OPCODE && cpu.fault_opcode_length == 2 &&
+                          cpu.fault_opcode[0] == PREFIX_REP && cpu.fault_opcode[1] == 0x90);
+
+    reset_cpu(&cpu);
+    cpu.memory[0] = 0x90;
+    execute_non_verbose(&cpu);
+    print_test_result("Fault keeps single opcode byte",
+                      cpu.fault == FAULT_INVALID_OPCODE && cpu.fault_ip == 0x00 &&
+                          cpu.fault_opcode_length == 1 && cpu.fault_opcode[0] == 0x90);
+}
+
+typedef struct
+{
+    uint32_t reported;
+    bool in_order;
+    uint8_t al[3];
+    bool halted[3];
+} BundleRunLog;
+
+static void log_bundle_guest(uint32_t index, const CPU *cpu, void *context)
+{
+    BundleRunLog *log = context;
+    log->in_order &= index == log->reported;
+    log->al[index % 3] = cpu->al;
+    log->halted[index % 3] = cpu->halted;
+    log->reported++;
+}
+
+void test_bundle()
+{
+    CPU guests[3], cpu;
+    uint16_t sizes[3] = {2, 7, 3};
+    reset_cpu(&guests[0]);
+    guests[0].memory[0] = 0xEB; // JMP -2
+    guests[0].memory[1] = 0xFE;
+    load_countdown(&guests[1]);
+    reset_cpu(&guests[2]);
+    uint8_t program[] = {0x00, 0xD8, // ADD AL, BL
+                         0xF4};
+    memcpy(guests[2].memory, program, sizeof(program));
+    guests[2].al = 5;
+    guests[2].bl = 3;
+
+    const char *path = "test_bundle.tbundle";
+    Bundle bundle;
+    bool opened = save_bundle(path, guests, sizes, 3) == 0 && open_bundle(&bundle, path) == 0;
+    print_test_result("Bundle round trip", opened && bundle.count == 3);
+
+    bool loaded = opened && load_bundle_program(&bundle, 2, &cpu) == 0;
+    while (loaded && !cpu.halted)
+    {
+        execute_non_verbose(&cpu);
+    }
+    print_test_result("Bundle guest with initial registers", loaded && cpu.al == 8);
+
+    loaded = opened && load_bundle_program(&bundle, 1, &cpu) == 0;
+    print_test_result("Bundle guest image",
+                      loaded && memcmp(cpu.memory, guests[1].memory, MEMORY_SIZE) == 0 &&
+                          cpu.al == 0 && cpu.sp == MEMORY_SIZE - 1);
+    print_test_result("Bundle rejects bad index", !opened || load_bundle_program(&bundle, 3, &cpu) != 0);
+
+    // Guest 0 never halts, so the others finish first and wait to be reported
+    BundleRunLog log = {.in_order = true};
+    if (opened)
+    {
+        run_bundle(&bundle, 2, 100000, log_bundle_guest, &log);
+    }
+    print_test_result("Bundle runs every guest in order",
+                      log.reported == 3 && log.in_order && log.halted[1] && log.halted[2] &&
+                          log.al[1] == 0 && log.al[2] == 8);
+    print_test_result("Bundle stops guest at step limit", log.reported == 3 && !log.halted[0]);
+    if (opened)
+    {
+        close_bundle(&bundle);
+    }
+
+    // Truncate the last image
+    uint8_t data[512];
+    FILE *f = fopen(path, "rb");
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    f = fopen(path, "wb");
+    fwrite(data, 1, size - 1, f);
+    fclose(f);
+    print_test_result("Bundle rejects truncated file", open_bundle(&bundle, path) != 0);
+    remove(path);
+}
+
+void test_fuzzer()
+{
+    CPU base;
+    reset_cpu(&base);
+    uint8_t program[] = {0x3C, 0x42, // CMP AL, 0x42
+                         0x75, 0x02, // JNE +2
+                         0xF6, 0xF3, // DIV BL (BL is 0)
+                         0xF4};
+    memcpy(base.memory, program, sizeof(program));
+
+    Fuzzer fuzzer;
+    init_fuzzer(&fuzzer, &base, 0, 0, 1234);
+    bool new_coverage;
+    FuzzResult result = fuzz_execute(&fuzzer, &fuzzer.corpus[0], &new_coverage);
+    print_test_result("Fuzz seed covers branch edge",
+                      result == FUZZ_OK && new_coverage && fuzzer.edges == 1);
+
+    while (fuzzer.num_crashes == 0 && fuzzer.execs < 100000)
+    {
+        fuzz_one(&fuzzer);
+    }
+    print_test_result("Fuzzer reports fault as crash",
+                      fuzzer.num_crashes == 1 && fuzzer.crashes[0].fault == FAULT_DIVIDE_ERROR &&
+                          fuzzer.crashes[0].ip == 0x04 && fuzzer.crashes[0].input.data[0] == 0x42 &&
+                          fuzzer.edges == 2);
+    free_fuzzer(&fuzzer);
+
+    base.memory[4] = 0x0F; // UD2 in place of the DIV
+    base.memory[5] = 0x0B;
+    init_fuzzer(&fuzzer, &base, 0, 0, 1234);
+    while (fuzzer.num_crashes == 0 && fuzzer.execs < 100000)
+    {
+        fuzz_one(&fuzzer);
+    }
+    print_test_result("Fuzzer crash keeps opcode bytes",
+                      fuzzer.num_crashes == 1 && fuzzer.crashes[0].opcode_length == 2 &&
+                          fuzzer.crashes[0].opcode[0] == 0x0F && fuzzer.crashes[0].opcode[1] == 0x0B);
+    free_fuzzer(&fuzzer);
+
+    reset_cpu(&base);
+    base.memory[0] = 0xEB; // JMP -2
+    base.memory[1] = 0xFE;
+    init_fuzzer(&fuzzer, &base, 0, 0, 1);
+    fuzzer.max_steps = 100;
+    result = fuzz_execute(&fuzzer, &fuzzer.corpus[0], &new_coverage);
+    print_test_result("Fuzzer reports hang", result == FUZZ_HANG && fuzzer.hangs == 1);
+    free_fuzzer(&fuzzer);
+}
+
 int main()
 {
     printf("Starting x86 Emulator Tests\n");
@@ -256,6 +783,14 @@ int main()
     test_jumps();
     test_stack();
     test_flags();
+    test_string_ops();
+    test_string_edge_cases();
+    test_time_travel();
+    test_analysis();
+    test_counters();
+    test_faults();
+    test_bundle();
+    test_fuzzer();
 
     printf("=====================================\n");
     printf("Test suite completed\n");
@@ -77,11 +77,281 @@ void log_message(const char *format, bool verbose, ...)
     }
 }
 
+// Stop execution the way HLT does, but leave a record of what went wrong
+static void raise_fault(CPU *cpu, uint8_t fault, uint8_t ip)
+{
+    cpu->fault = fault;
+    cpu->fault_ip = ip;
+    cpu->halted = true;
+}
+
+// Keep the bytes that were actually decoded, so two-byte forms are
+// reported in full
+static void raise_invalid_opcode(CPU *cpu, uint8_t ip, uint8_t opcode, uint8_t length, uint8_t second)
+{
+    cpu->fault_opcode[0] = opcode;
+    cpu->fault_opcode[1] = second;
+    cpu->fault_opcode_length = length;
+    raise_fault(cpu, FAULT_INVALID_OPCODE, ip);
+}
+
+// Counters as a guest sees them mid-instruction: the instruction reading
+// them is counted as already retired
+static uint64_t read_guest_counter(const CPU *cpu, CounterId id)
+{
+    return read_counter(cpu, id) + (id == CTR_INSTRUCTIONS);
+}
+
+// Coverage edge from the branch at `from` to wherever it left IP
+static void record_edge(CPU *cpu, uint8_t from)
+{
+    if (cpu->coverage)
+    {
+        coverage_record(cpu->coverage, from, cpu->ip);
+    }
+}
+
+static void take_branch(CPU *cpu, uint8_t from, int8_t offset)
+{
+    cpu->ip += offset;
+    cpu->counters.values[CTR_BRANCHES_TAKEN]++;
+    record_edge(cpu, from);
+}
+
+// Conditional jumps record the fallthrough as an edge too
+static void branch_if(CPU *cpu, uint8_t from, int8_t offset, bool taken)
+{
+    if (taken)
+        take_branch(cpu, from, offset);
+    else
+        record_edge(cpu, from);
+}
+
+// RDTSC/RDPMC results go to DX:AX, the low 32 bits of the counter
+static void set_dx_ax(CPU *cpu, uint64_t value)
+{
+    cpu->al = value;
+    cpu->ah = value >> 8;
+    cpu->dl = value >> 16;
+    cpu->dh = value >> 24;
+}
+
+static uint16_t get_cx(const CPU *cpu)
+{
+    return cpu->ch << 8 | cpu->cl;
+}
+
+static void set_cx(CPU *cpu, uint16_t value)
+{
+    cpu->cl = value & 0xFF;
+    cpu->ch = value >> 8;
+}
+
+// Lowest address of a `count` byte run starting at `addr` and moving by
+// `step`, or -1 if the run wraps around memory
+static int span_start(uint8_t addr, uint16_t count, int8_t step)
+{
+    if (step > 0)
+    {
+        return addr + count <= MEMORY_SIZE ? addr : -1;
+    }
+    return addr + 1 >= count ? addr + 1 - count : -1;
+}
+
+// String instructions run all `count` iterations in one go. Each helper
+// leaves memory, SI/DI and flags exactly as `count` single-byte iterations
+// would; stores bypass the icache just like PUSH and CALL.
+static void string_movsb(CPU *cpu, uint16_t count, int8_t step)
+{
+    int src = span_start(cpu->si, count, step);
+    int dst = span_start(cpu->di, count, step);
+
+    // memmove only matches a byte-at-a-time copy when the destination does
+    // not sit ahead of the source in the direction of travel
+    bool forward_safe = cpu->di <= cpu->si || cpu->di >= cpu->si + count;
+    bool backward_safe = cpu->di >= cpu->si || cpu->di + count <= cpu->si;
+
+    if (src >= 0 && dst >= 0 && (step > 0 ? forward_safe : backward_safe))
+    {
+        memmove(&cpu->memory[dst], &cpu->memory[src], count);
+    }
+    else
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            cpu->memory[(uint8_t)(cpu->di + i * step)] = cpu->memory[(uint8_t)(cpu->si + i * step)];
+        }
+    }
+    cpu->si += count * step;
+    cpu->di += count * step;
+}
+
+static void string_stosb(CPU *cpu, uint16_t count, int8_t step)
+{
+    int dst = span_start(cpu->di, count, step);
+
+    if (dst >= 0)
+    {
+        memset(&cpu->memory[dst], cpu->al, count);
+    }
+    else
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            cpu->memory[(uint8_t)(cpu->di + i * step)] = cpu->al;
+        }
+    }
+    cpu->di += count * step;
+}
+
+static void string_lodsb(CPU *cpu, uint16_t count, int8_t step)
+{
+    // Only the last load is observable
+    cpu->al = cpu->memory[(uint8_t)(cpu->si + (count - 1) * step)];
+    cpu->si += count * step;
+}
+
+// Length of the common prefix of `a` and `b`, compared a word at a time
+static uint16_t equal_prefix(const uint8_t *a, const uint8_t *b, uint16_t count)
+{
+    uint16_t i = 0;
+    uint64_t x, y;
+    while (i + sizeof(x) <= count)
+    {
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        if (x != y)
+        {
+            break;
+        }
+        i += sizeof(x);
+    }
+    while (i < count && a[i] == b[i])
+    {
+        i++;
+    }
+    return i;
+}
+
+// Length of the common suffix of the `count` bytes at `a` and `b`
+static uint16_t equal_suffix(const uint8_t *a, const uint8_t *b, uint16_t count)
+{
+    uint16_t i = 0;
+    uint64_t x, y;
+    while (i + sizeof(x) <= count)
+    {
+        memcpy(&x, a + count - i - sizeof(x), sizeof(x));
+        memcpy(&y, b + count - i - sizeof(y), sizeof(y));
+        if (x != y)
+        {
+            break;
+        }
+        i += sizeof(x);
+    }
+    while (i < count && a[count - i - 1] == b[count - i - 1])
+    {
+        i++;
+    }
+    return i;
+}
+
+// Returns the number of iterations performed, which is less than `count`
+// when a REPE/REPNE termination condition fires
+static uint16_t string_cmpsb(CPU *cpu, uint16_t count, int8_t step, uint8_t prefix)
+{
+    bool stop_on_equal = prefix == PREFIX_REPNE;
+    bool stop_on_differ = prefix == PREFIX_REP;
+    int src = span_start(cpu->si, count, step);
+    int dst = span_start(cpu->di, count, step);
+    uint16_t done = 0;
+    uint8_t result;
+
+    // REPE over runs that do not wrap skips the matching bytes in bulk. REPNE
+    // stops on the first equal byte, which a word compare cannot find any
+    // faster, so it and the wrapping cases take the byte loop.
+    if (stop_on_differ && src >= 0 && dst >= 0)
+    {
+        uint16_t same = step > 0 ? equal_prefix(&cpu->memory[src], &cpu->memory[dst], count)
+                                 : equal_suffix(&cpu->memory[src], &cpu->memory[dst], count);
+        done = same < count ? same + 1 : count;
+        result = cpu->memory[(uint8_t)(cpu->si + (done - 1) * step)] -
+                 cpu->memory[(uint8_t)(cpu->di + (done - 1) * step)];
+        update_flags(cpu, result);
+        cpu->si += done * step;
+        cpu->di += done * step;
+        return done;
+    }
+
+    // Only the final comparison's flags survive, so scan without touching
+    // CPU state and apply the outcome once
+    do
+    {
+        result = cpu->memory[(uint8_t)(cpu->si + done * step)] -
+                 cpu->memory[(uint8_t)(cpu->di + done * step)];
+        done++;
+    } while (done < count &&
+             !(stop_on_equal && result == 0) &&
+             !(stop_on_differ && result != 0));
+
+    update_flags(cpu, result);
+    cpu->si += done * step;
+    cpu->di += done * step;
+    return done;
+}
+
+static void execute_string(CPU *cpu, uint8_t opcode, uint8_t prefix, bool verbose)
+{
+    int8_t step = (cpu->flags & FLAG_DIRECTION) ? -1 : 1;
+    uint16_t count = prefix ? get_cx(cpu) : 1;
+
+    // REP with CX = 0 performs no iterations and leaves flags alone
+    if (count == 0)
+    {
+        log_message("REP with CX = 0, skipped\n", verbose);
+        return;
+    }
+
+    switch (opcode)
+    {
+    case 0xA4: // MOVSB
+        string_movsb(cpu, count, step);
+        log_message("MOVSB: %u bytes, SI 0x%02X, DI 0x%02X\n", verbose, count, cpu->si, cpu->di);
+        break;
+
+    case 0xAA: // STOSB
+        string_stosb(cpu, count, step);
+        log_message("STOSB: %u bytes of 0x%02X, DI 0x%02X\n", verbose, count, cpu->al, cpu->di);
+        break;
+
+    case 0xAC: // LODSB
+        string_lodsb(cpu, count, step);
+        log_message("LODSB: AL 0x%02X, SI 0x%02X\n", verbose, cpu->al, cpu->si);
+        break;
+
+    case 0xA6: // CMPSB
+        count = string_cmpsb(cpu, count, step, prefix);
+        log_message("CMPSB: %u compares, flags 0x%02X\n", verbose, count, cpu->flags);
+        break;
+    }
+
+    if (prefix)
+    {
+        set_cx(cpu, get_cx(cpu) - count);
+    }
+}
+
 void execute(CPU *cpu, bool verbose)
 {
+    if (cpu->halted)
+    {
+        return;
+    }
+
+    uint8_t start_ip = cpu->ip;
     uint8_t opcode = fetch_byte(cpu);
     uint8_t *dest, *src;
     uint8_t modrm, value;
+    uint8_t operation = opcode; // Histogram key: the opcode after any prefix
 
     // Debug output
     log_message("Executing opcode 0x%02X at IP 0x%02X\n", verbose, opcode, cpu->ip - 1);
@@ -168,7 +438,8 @@ void execute(CPU *cpu, bool verbose)
             if (*src == 0)
             {
                 log_message("Division by zero\n", verbose);
-                exit(1);
+                raise_fault(cpu, FAULT_DIVIDE_ERROR, start_ip);
+                break;
             }
             value = (cpu->ah << 8 | cpu->al) / *src;
             cpu->al = value;
@@ -216,7 +487,7 @@ void execute(CPU *cpu, bool verbose)
 
     case 0xEB: // JMP rel8
         value = fetch_byte(cpu);
-        cpu->ip += (int8_t)value;
+        take_branch(cpu, start_ip, value);
         break;
 
     case 0x38: // CMP r/m8, r8
@@ -229,30 +500,28 @@ void execute(CPU *cpu, bool verbose)
 
     case 0x74: // JE rel8
         value = fetch_byte(cpu);
-        if (cpu->flags & FLAG_ZERO)
-            cpu->ip += (int8_t)value;
+        branch_if(cpu, start_ip, value, cpu->flags & FLAG_ZERO);
         break;
 
     case 0x75: // JNE rel8
         value = fetch_byte(cpu);
-        if (!(cpu->flags & FLAG_ZERO))
-            cpu->ip += (int8_t)value;
+        branch_if(cpu, start_ip, value, !(cpu->flags & FLAG_ZERO));
         break;
 
     case 0x7F: // JG rel8
         value = fetch_byte(cpu);
-        if (!(cpu->flags & FLAG_ZERO) &&
-            !(cpu->flags & FLAG_SIGN))
-            cpu->ip += (int8_t)value;
+        branch_if(cpu, start_ip, value,
+                  !(cpu->flags & FLAG_ZERO) &&
+                      !(cpu->flags & FLAG_SIGN));
         break;
 
     case 0x7E: // JLE rel8
     {
         int8_t offset = (int8_t)fetch_byte(cpu);
         bool take_jump = (cpu->flags & FLAG_ZERO) || (cpu->flags & FLAG_SIGN);
+        branch_if(cpu, start_ip, offset, take_jump);
         if (take_jump)
         {
-            cpu->ip += offset;
             log_message("JLE taken to 0x%02X\n", verbose, cpu->ip);
         }
         else
@@ -270,6 +539,8 @@ void execute(CPU *cpu, bool verbose)
         uint8_t return_addr = cpu->ip;
         cpu->memory[--cpu->sp] = return_addr;
         cpu->ip += offset;
+        cpu->counters.values[CTR_CALLS]++;
+        record_edge(cpu, start_ip);
         log_message("CALL: offset 0x%04X, from 0x%02X to 0x%02X, pushed return addr 0x%02X\n",
                     verbose, (uint16_t)offset, cpu->ip - 3, cpu->ip, return_addr);
     }
@@ -279,6 +550,8 @@ void execute(CPU *cpu, bool verbose)
     {
         uint8_t return_addr = cpu->memory[cpu->sp++];
         cpu->ip = return_addr;
+        cpu->counters.values[CTR_RETURNS]++;
+        record_edge(cpu, start_ip);
         log_message("RET to 0x%02X\n", verbose, cpu->ip);
     }
     break;
@@ -323,31 +596,145 @@ void execute(CPU *cpu, bool verbose)
                     verbose, cpu->al, value, result, cpu->flags);
         break;
 
+    case 0xB9: // MOV CX, imm16
+        value = fetch_byte(cpu);
+        cpu->cl = value;
+        cpu->ch = fetch_byte(cpu);
+        log_message("MOV CX, 0x%02X%02X\n", verbose, cpu->ch, cpu->cl);
+        break;
+
+    case 0xBE: // MOV SI, imm16
+    case 0xBF: // MOV DI, imm16
+        // Memory is only 256 bytes, so the high byte is dropped
+        value = fetch_byte(cpu);
+        fetch_byte(cpu);
+        if (opcode == 0xBE)
+            cpu->si = value;
+        else
+            cpu->di = value;
+        log_message("MOV %s, 0x%02X\n", verbose, opcode == 0xBE ? "SI" : "DI", value);
+        break;
+
+    case 0x0F: // Two-byte opcodes
+        value = fetch_byte(cpu);
+        operation = value;
+        switch (value)
+        {
+        case 0x31: // RDTSC, instructions retired including this one
+            set_dx_ax(cpu, read_guest_counter(cpu, CTR_INSTRUCTIONS));
+            log_message("RDTSC: DX:AX 0x%02X%02X%02X%02X\n", verbose, cpu->dh, cpu->dl, cpu->ah, cpu->al);
+            break;
+        case 0x33: // RDPMC, counter selected by CL
+            set_dx_ax(cpu, read_guest_counter(cpu, (CounterId)cpu->cl));
+            log_message("RDPMC %u: DX:AX 0x%02X%02X%02X%02X\n", verbose, cpu->cl, cpu->dh, cpu->dl, cpu->ah, cpu->al);
+            break;
+        default:
+            log_message("Unknown opcode: 0x0F 0x%02X at IP 0x%02X\n", verbose, value, start_ip);
+            raise_invalid_opcode(cpu, start_ip, opcode, 2, value);
+            break;
+        }
+        break;
+
+    case 0xFC: // CLD
+        cpu->flags &= ~FLAG_DIRECTION;
+        break;
+
+    case 0xFD: // STD
+        cpu->flags |= FLAG_DIRECTION;
+        break;
+
+    case 0xA4: // MOVSB
+    case 0xA6: // CMPSB
+    case 0xAA: // STOSB
+    case 0xAC: // LODSB
+        execute_string(cpu, opcode, 0, verbose);
+        break;
+
+    case PREFIX_REPNE: // REPNE
+    case PREFIX_REP:   // REP/REPE
+        value = fetch_byte(cpu);
+        operation = value;
+        if (value != 0xA4 && value != 0xA6 && value != 0xAA && value != 0xAC)
+        {
+            log_message("Unsupported REP prefixed opcode: 0x%02X at IP 0x%02X\n", verbose, value, start_ip);
+            raise_invalid_opcode(cpu, start_ip, opcode, 2, value);
+            break;
+        }
+        execute_string(cpu, value, opcode, verbose);
+        break;
+
     case 0xF4: // HLT
-        log_message("\nProgram halted\n", true);
-        log_message("Final register values:\n", true);
-        log_message("AL: 0x%02X (%d)\n", true, cpu->al, cpu->al);
-        log_message("BL: 0x%02X (%d)\n", true, cpu->bl, cpu->bl);
-        log_message("CL: 0x%02X (%d)\n", true, cpu->cl, cpu->cl);
-        log_message("DL: 0x%02X (%d)\n", true, cpu->dl, cpu->dl);
-        log_message("SP: 0x%02X\n", true, cpu->sp);
-        log_message("IP: 0x%02X\n", true, cpu->ip);
-        log_message("Flags: 0x%02X\n", true, cpu->flags);
-        print_cache_stats(&cpu->icache);
-        exit(0);
+        cpu->halted = true;
+        break;
 
     default:
-        log_message("Unknown opcode: 0x%02X at IP 0x%02X\n", true, opcode, cpu->ip - 1);
-        exit(1);
+        log_message("Unknown opcode: 0x%02X at IP 0x%02X\n", verbose, opcode, start_ip);
+        raise_invalid_opcode(cpu, start_ip, opcode, 1, 0);
+        break;
+    }
+
+    // Faulting instructions do not retire
+    if (!cpu->fault)
+    {
+        cpu->counters.values[CTR_INSTRUCTIONS]++;
+        if (opcode == 0x0F)
+            cpu->counters.opcodes_0f[operation]++;
+        else
+            cpu->counters.opcodes[operation]++;
+    }
+
+    uint8_t depth = (MEMORY_SIZE - 1) - cpu->sp;
+    if (depth > cpu->counters.values[CTR_STACK_HIGH_WATER])
+    {
+        cpu->counters.values[CTR_STACK_HIGH_WATER] = depth;
+    }
+}
+
+void print_cpu_state(const CPU *cpu)
+{
+    printf("\nProgram halted\n");
+    printf("Final register values:\n");
+    printf("AL: 0x%02X (%d)\n", cpu->al, cpu->al);
+    printf("BL: 0x%02X (%d)\n", cpu->bl, cpu->bl);
+    printf("CL: 0x%02X (%d)\n", cpu->cl, cpu->cl);
+    printf("DL: 0x%02X (%d)\n", cpu->dl, cpu->dl);
+    printf("SP: 0x%02X\n", cpu->sp);
+    printf("IP: 0x%02X\n", cpu->ip);
+    printf("Flags: 0x%02X\n", cpu->flags);
+    print_cache_stats(&cpu->icache);
+}
+
+void print_fault(const CPU *cpu)
+{
+    switch (cpu->fault)
+    {
+    case FAULT_INVALID_OPCODE:
+        printf("Unknown opcode: 0x%02X", cpu->fault_opcode[0]);
+        if (cpu->fault_opcode_length == 2)
+        {
+            printf(" 0x%02X", cpu->fault_opcode[1]);
+        }
+        printf(" at IP 0x%02X\n", cpu->fault_ip);
+        break;
+    case FAULT_DIVIDE_ERROR:
+        printf("Division by zero at IP 0x%02X\n", cpu->fault_ip);
+        break;
     }
 }
 
 void run_cpu(CPU *cpu, bool verbose)
 {
-    while (1)
+    while (!cpu->halted)
     {
         execute(cpu, verbose);
     }
+
+    if (cpu->fault)
+    {
+        print_fault(cpu);
+        return;
+    }
+    print_cpu_state(cpu);
 }
 
 int load_program(CPU *cpu, const char *filename, bool verbose)
@@ -390,6 +777,17 @@ int load_program(CPU *cpu, const char *filename, bool verbose)
         return -1;
     }
 
-    printf("Loaded %ld bytes into memory\n", size);
-    return 0;
-}
\ No newline at end of file
+    return size;
+}
+
+// Non-negative integer option value in any base strtoul accepts
+bool parse_count(const char *text, unsigned long long *value)
+{
+    char *end;
+    if (*text < '0' || *text > '9')
+    {
+        return false;
+    }
+    *value = strtoull(text, &end, 0);
+    return *end == '\0';
+}
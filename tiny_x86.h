@@ -4,13 +4,23 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "cache.h"
+#include "counters.h"
+#include "coverage.h"
 
 #define MEMORY_SIZE 256
 #define FLAG_CARRY 0x01
 #define FLAG_ZERO 0x40
 #define FLAG_SIGN 0x80
+#define FLAG_DIRECTION 0x0400
 
-typedef struct
+#define FAULT_NONE 0
+#define FAULT_INVALID_OPCODE 1
+#define FAULT_DIVIDE_ERROR 2
+
+#define PREFIX_REPNE 0xF2
+#define PREFIX_REP 0xF3 // REPE for CMPSB
+
+typedef struct CPU
 {
     union
     {
@@ -23,16 +33,29 @@ typedef struct
         };
         uint8_t regs[8];
     };
+    uint8_t si;
+    uint8_t di;
     uint8_t memory[MEMORY_SIZE];
     uint8_t ip;
     uint8_t sp;
-    uint8_t flags;
+    uint16_t flags;
+    bool halted;
+    uint8_t fault;    // FAULT_* that stopped execution, if any
+    uint8_t fault_ip; // Address of the faulting instruction
+    uint8_t fault_opcode[2];     // Bytes decoded before FAULT_INVALID_OPCODE
+    uint8_t fault_opcode_length; // 1, or 2 for 0F xx and REP/REPNE xx
     InstructionCache icache;
+    PerfCounters counters;
+    CoverageMap *coverage; // Branch edges are recorded here when set
 } CPU;
 
 void init_cpu(CPU *cpu);
 void execute(CPU *cpu, bool verbose);
 void run_cpu(CPU *cpu, bool verbose);
+void print_cpu_state(const CPU *cpu);
+void print_fault(const CPU *cpu);
+// Returns the number of bytes loaded, or -1 on error
 int load_program(CPU *cpu, const char *filename, bool verbose);
+bool parse_count(const char *text, unsigned long long *value);
 
 #endif
\ No newline at end of file